@@ -4,17 +4,611 @@
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <array>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 
 #include "elf.hpp"
 
 typedef uint8_t byte_t;
 
+struct blob {
+    std::string path;
+    std::vector<uint8_t> data;
+    bool read_ok;
+};
+
+static bool read_blob(blob& b)
+{
+    FILE* file = fopen(b.path.c_str(), "r");
+    if (file == nullptr) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    auto size = ftell(file);
+    auto ok = size >= 0;
+    if (ok) {
+        b.data.resize(size);
+        fseek(file, 0, SEEK_SET);
+        ok = b.data.empty() || fread(b.data.data(), b.data.size(), 1, file) == 1;
+    }
+    fclose(file);
+    return ok;
+}
+
+static void read_blobs(std::vector<blob>& blobs)
+{
+    auto worker_count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), blobs.size());
+    auto next = std::atomic<size_t>{0};
+    auto workers = std::vector<std::jthread>{};
+    for (size_t i = 0; i < worker_count; i++) {
+        workers.emplace_back(
+                [&blobs, &next]() {
+                    for (auto j = next++; j < blobs.size(); j = next++) {
+                        blobs[j].read_ok = read_blob(blobs[j]);
+                    }
+                }
+                );
+    }
+}
+
+static std::string mangle(std::string_view path)
+{
+    auto name = std::string{};
+    for (auto c : path) {
+        name.push_back(isalnum(static_cast<unsigned char>(c)) ? c : '_');
+    }
+    return name;
+}
+
+// one ET_REL holding every blob in its own section, with objcopy style
+// _binary_<name>_start/_end/_size symbols
+struct packed_object {
+    elf64::elf_header elf_header;
+    std::vector<elf64::section_header> section_headers;
+    elf64::build::symbol_table symbol_table;
+    std::vector<char> strings;
+    size_t symbol_section_index;
+    size_t symbol_name_section_index;
+    size_t section_name_section_index;
+    std::vector<uint32_t> blob_symbol_indices; // index of _start, _end and _size follow it
+
+    auto& blob_section(size_t blob_index) {
+        return section_headers[1 + blob_index];
+    }
+};
+
+static packed_object layout_blobs(const std::vector<blob>& blobs, size_t alignment)
+{
+    auto object = packed_object{};
+    auto allocator = elf64::linear_allocator{};
+    auto elf_header_offset = allocator.allocate(sizeof(object.elf_header));
+    assert(elf_header_offset == 0);
+
+    auto& section_headers = object.section_headers;
+    // null section, blobs, .note.GNU-stack, symbol and string tables
+    section_headers.resize(1 + blobs.size() + 4);
+    auto stack_note_section_index = 1 + blobs.size();
+    object.symbol_section_index = stack_note_section_index + 1;
+    object.symbol_name_section_index = object.symbol_section_index + 1;
+    object.section_name_section_index = object.symbol_section_index + 2;
+
+    auto& strings = object.strings;
+    strings.push_back('\0');
+    auto add_string = [&strings](std::string_view str) {
+        auto index = static_cast<uint32_t>(strings.size());
+        strings.append_range(str);
+        strings.push_back('\0');
+        return index;
+    };
+
+    auto symbols = elf64::build::symbol_table_builder{};
+    symbols.reserve(3 * blobs.size());
+    auto blob_symbol_handles = std::vector<size_t>{};
+    blob_symbol_handles.reserve(blobs.size());
+
+    auto mangled_names = std::unordered_map<std::string, size_t>{};
+    for (size_t i = 0; i < blobs.size(); i++) {
+        auto& b = blobs[i];
+        auto section_index = static_cast<uint16_t>(1 + i);
+        auto name = mangle(b.path);
+        auto [it, inserted] = mangled_names.emplace(name, i);
+        if (!inserted) {
+            fprintf(stderr, "%s and %s both map to symbol _binary_%s_start\n",
+                    blobs[it->second].path.c_str(), b.path.c_str(), name.c_str());
+            exit(-1);
+        }
+        auto& section = object.blob_section(i);
+        section.sh_name = add_string(".rodata." + name);
+        section.sh_type = SHT_PROGBITS;
+        section.sh_flags = SHF_ALLOC;
+        section.sh_offset = allocator.allocate(b.data.size(), alignment);
+        section.sh_size = b.data.size();
+        section.sh_addralign = alignment;
+
+        blob_symbol_handles.push_back(symbols.add(elf64::symbol{
+                .st_name = add_string("_binary_" + name + "_start"),
+                .st_info = ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT),
+                .st_other = STV_DEFAULT,
+                .st_shndx = section_index,
+                .st_value = 0,
+                .st_size = b.data.size(),
+                }));
+        symbols.add(elf64::symbol{
+                .st_name = add_string("_binary_" + name + "_end"),
+                .st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE),
+                .st_other = STV_DEFAULT,
+                .st_shndx = section_index,
+                .st_value = b.data.size(),
+                .st_size = 0,
+                });
+        symbols.add(elf64::symbol{
+                .st_name = add_string("_binary_" + name + "_size"),
+                .st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE),
+                .st_other = STV_DEFAULT,
+                .st_shndx = SHN_ABS,
+                .st_value = b.data.size(),
+                .st_size = 0,
+                });
+    }
+
+    auto& stack_note_section = section_headers[stack_note_section_index];
+    stack_note_section.sh_name = add_string(".note.GNU-stack");
+    stack_note_section.sh_type = SHT_PROGBITS;
+    // the tables start on a blob alignment boundary, so the last blob gets a whole slot like
+    // the others and a size change within it does not move anything after it
+    stack_note_section.sh_offset = allocator.allocate(0, alignment);
+    stack_note_section.sh_addralign = 1;
+
+    auto& symbol_table = object.symbol_table;
+    symbol_table = symbols.build();
+    for (auto handle : blob_symbol_handles) {
+        object.blob_symbol_indices.push_back(symbols.index(handle));
+    }
+
+    auto& section_name_section = section_headers[object.section_name_section_index];
+    auto& symbol_name_section = section_headers[object.symbol_name_section_index];
+    auto& symbol_section = section_headers[object.symbol_section_index];
+    section_name_section.sh_name = add_string(".shstrtab");
+    symbol_name_section.sh_name = add_string(".strtab");
+    symbol_section.sh_name = add_string(".symtab");
+
+    auto strings_offset = allocator.allocate(sizeof(strings[0])*strings.size());
+    for (auto* section : {&section_name_section, &symbol_name_section}) {
+        section->sh_type = SHT_STRTAB;
+        section->sh_offset = strings_offset;
+        section->sh_size = sizeof(strings[0])*strings.size();
+        section->sh_addralign = 1;
+    }
+
+    symbol_section.sh_offset = allocator.allocate(symbol_table.content_size(), 8);
+    symbol_section.sh_size = symbol_table.content_size();
+    symbol_section.sh_type = SHT_SYMTAB;
+    symbol_section.sh_info = symbol_table.first_global_index();
+    symbol_section.sh_link = object.symbol_name_section_index;
+    symbol_section.sh_entsize = sizeof(elf64::symbol);
+    symbol_section.sh_addralign = 8;
+
+    auto section_headers_offset = allocator.allocate(sizeof(section_headers[0])*section_headers.size(), 8);
+    auto elf_header_helper = elf64::helper::elf_header{
+        .type = ET_REL,
+        .section_string_section_index = static_cast<uint32_t>(object.section_name_section_index),
+        .section_offset = section_headers_offset,
+        .section_count = section_headers.size(),
+    };
+    object.elf_header = elf_header_helper;
+    return object;
+}
+
+// writes in offset order, padding alignment gaps instead of seeking
+static void write_at(FILE* file, size_t& position, size_t offset, const void* data, size_t size)
+{
+    assert(offset >= position);
+    for (; position < offset; position++) {
+        auto res = fputc(0, file);
+        assert(res == 0);
+    }
+    if (size > 0) {
+        auto res = fwrite(data, size, 1, file);
+        assert(res == 1);
+    }
+    position += size;
+}
+
+static void write_packed(FILE* elf_file, const packed_object& object, const std::vector<blob>& blobs)
+{
+    auto position = size_t{0};
+    write_at(elf_file, position, 0, &object.elf_header, sizeof(object.elf_header));
+    for (size_t i = 0; i < blobs.size(); i++) {
+        auto& section = object.section_headers[1 + i];
+        write_at(elf_file, position, section.sh_offset, blobs[i].data.data(), blobs[i].data.size());
+    }
+    auto& strings = object.strings;
+    write_at(elf_file, position, object.section_headers[object.symbol_name_section_index].sh_offset,
+            strings.data(), sizeof(strings[0])*strings.size());
+    auto& symbol_table = object.symbol_table;
+    write_at(elf_file, position, object.section_headers[object.symbol_section_index].sh_offset,
+            symbol_table.data(), symbol_table.content_size());
+    auto& section_headers = object.section_headers;
+    write_at(elf_file, position, object.elf_header.e_shoff,
+            section_headers.data(), sizeof(section_headers[0])*section_headers.size());
+}
+
+// replaces the output atomically, so a build never links a half written object,
+// and returns the status of the file it put there
+static struct stat write_packed_file(const char* elf_file_name, const packed_object& object, const std::vector<blob>& blobs)
+{
+    auto temporary_name = std::string{elf_file_name} + ".tmp";
+    FILE* elf_file = fopen(temporary_name.c_str(), "w");
+    assert(elf_file);
+    write_packed(elf_file, object, blobs);
+    fflush(elf_file);
+    struct stat written;
+    auto res = fstat(fileno(elf_file), &written);
+    assert(res == 0);
+    fclose(elf_file);
+    res = rename(temporary_name.c_str(), elf_file_name);
+    assert(res == 0);
+    return written;
+}
+
+// an output that was deleted, replaced or modified since it was written is not patched
+static bool same_file(const struct stat& a, const struct stat& b)
+{
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size
+        && a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+static bool pwrite_all(int fd, const void* data, size_t size, size_t offset)
+{
+    for (size_t done = 0; done < size;) {
+        auto count = pwrite(fd, static_cast<const byte_t*>(data) + done, size - done, offset + done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        done += count;
+    }
+    return true;
+}
+
+// true when every section and the section headers sit at the same offsets,
+// patching the changed blobs then gives the same bytes as writing b from scratch
+static bool same_layout(const packed_object& a, const packed_object& b)
+{
+    if (a.elf_header.e_shoff != b.elf_header.e_shoff || a.section_headers.size() != b.section_headers.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.section_headers.size(); i++) {
+        if (a.section_headers[i].sh_offset != b.section_headers[i].sh_offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// rewrites the payload of a blob whose layout did not move, and its
+// section header and symbols if the size changed, returns false on a write error
+static bool update_blob(int fd, packed_object& object, size_t blob_index, const blob& b)
+{
+    auto& section = object.blob_section(blob_index);
+    auto old_size = section.sh_size;
+    auto new_size = b.data.size();
+    if (!pwrite_all(fd, b.data.data(), new_size, section.sh_offset)) {
+        return false;
+    }
+    if (new_size == old_size) {
+        return true;
+    }
+    if (new_size < old_size) {
+        auto zeros = std::vector<uint8_t>(old_size - new_size);
+        if (!pwrite_all(fd, zeros.data(), zeros.size(), section.sh_offset + new_size)) {
+            return false;
+        }
+    }
+    section.sh_size = new_size;
+    if (!pwrite_all(fd, &section, sizeof(section), object.elf_header.e_shoff + sizeof(section) * (1 + blob_index))) {
+        return false;
+    }
+
+    auto first = object.blob_symbol_indices[blob_index];
+    auto& symbol_table = object.symbol_table;
+    symbol_table[first].st_size = new_size;
+    symbol_table[first + 1].st_value = new_size;
+    symbol_table[first + 2].st_value = new_size;
+    return pwrite_all(fd, &symbol_table[first], 3 * sizeof(elf64::symbol),
+            object.section_headers[object.symbol_section_index].sh_offset + first * sizeof(elf64::symbol));
+}
+
+static bool update_blobs(int fd, packed_object& object, const std::vector<blob>& blobs, const std::vector<size_t>& updated)
+{
+    for (auto i : updated) {
+        if (!update_blob(fd, object, i, blobs[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// patches the changed blobs into a reflinked copy of the output and renames it over the
+// output, so a link running meanwhile reads either object whole. Without reflinks the blobs
+// are patched into the output itself, where such a link can read a mix of both, unless
+// atomic is set. Returns false when the output is no longer the file described by written,
+// when only an atomic full rewrite is left, or on any I/O error, the caller then rewrites
+// the whole object, which also repairs a partly patched output
+static bool update_packed_file(const char* elf_file_name, struct stat& written, packed_object& object,
+        const std::vector<blob>& blobs, const std::vector<size_t>& updated, bool atomic)
+{
+    auto elf_fd = open(elf_file_name, O_RDWR | O_CLOEXEC);
+    struct stat status;
+    if (elf_fd < 0) {
+        return false;
+    }
+    if (fstat(elf_fd, &status) != 0 || !same_file(status, written)) {
+        close(elf_fd);
+        return false;
+    }
+    auto temporary_name = std::string{elf_file_name} + ".tmp";
+    auto temporary_fd = open(temporary_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (temporary_fd >= 0 && ioctl(temporary_fd, FICLONE, elf_fd) == 0) {
+        close(elf_fd);
+        auto ok = update_blobs(temporary_fd, object, blobs, updated) && fstat(temporary_fd, &written) == 0;
+        ok = close(temporary_fd) == 0 && ok;
+        if (!ok || rename(temporary_name.c_str(), elf_file_name) != 0) {
+            unlink(temporary_name.c_str());
+            return false;
+        }
+        return true;
+    }
+    if (temporary_fd >= 0) {
+        close(temporary_fd);
+        unlink(temporary_name.c_str());
+    }
+    if (atomic) {
+        close(elf_fd);
+        return false;
+    }
+    auto ok = update_blobs(elf_fd, object, blobs, updated) && fstat(elf_fd, &written) == 0;
+    return close(elf_fd) == 0 && ok;
+}
+
+// keeps the layout in memory and regenerates the output whenever an input is written,
+// rewriting only the changed blobs while the layout stays the same
+static int watch(const char* elf_file_name, std::vector<blob>& blobs, packed_object& object, size_t alignment,
+        bool atomic, struct stat written)
+{
+    auto notify_fd = inotify_init1(IN_CLOEXEC);
+    assert(notify_fd >= 0);
+    // directories are watched instead of files, which also catches editors that rename over the input
+    auto blob_indices = std::unordered_map<std::string, std::vector<size_t>>{};
+    for (size_t i = 0; i < blobs.size(); i++) {
+        auto path = std::string_view{blobs[i].path};
+        auto slash = path.rfind('/');
+        auto directory = slash == std::string_view::npos ? std::string{"."} : std::string{path.substr(0, slash + 1)};
+        auto name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+        auto wd = inotify_add_watch(notify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            fprintf(stderr, "failed to watch %s\n", directory.c_str());
+            exit(-1);
+        }
+        blob_indices[std::to_string(wd) + "/" + std::string{name}].push_back(i);
+    }
+
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        auto length = read(notify_fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        assert(length > 0);
+
+        auto changed = std::vector<bool>(blobs.size());
+        for (auto p = buffer; p < buffer + length;) {
+            auto event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                changed.assign(blobs.size(), true);
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+            auto it = blob_indices.find(std::to_string(event->wd) + "/" + event->name);
+            if (it != blob_indices.end()) {
+                for (auto i : it->second) {
+                    changed[i] = true;
+                }
+            }
+        }
+
+        auto updated = std::vector<size_t>{};
+        for (size_t i = 0; i < blobs.size(); i++) {
+            if (!changed[i]) {
+                continue;
+            }
+            auto b = blob{.path = blobs[i].path};
+            if (!read_blob(b)) {
+                fprintf(stderr, "failed to read %s\n", b.path.c_str());
+                continue;
+            }
+            blobs[i] = std::move(b);
+            updated.push_back(i);
+        }
+        if (updated.empty()) {
+            continue;
+        }
+        // a size change can move the following blobs even within the old slot, so only
+        // patch when a fresh pack would put everything where it already is, and the
+        // output is still the file written last
+        auto fresh = layout_blobs(blobs, alignment);
+        if (same_layout(object, fresh) && update_packed_file(elf_file_name, written, object, blobs, updated, atomic)) {
+            for (auto i : updated) {
+                printf("updated %s\n", blobs[i].path.c_str());
+            }
+        }
+        else {
+            object = std::move(fresh);
+            written = write_packed_file(elf_file_name, object, blobs);
+            printf("rewrote %s\n", elf_file_name);
+        }
+        fflush(stdout);
+    }
+}
+
+static int pack(int argc, char** argv)
+{
+    auto alignment = size_t{16};
+    auto watching = false;
+    auto atomic = false;
+    while (argc >= 1 && strncmp(argv[0], "--", 2) == 0) {
+        if (argc >= 2 && strcmp(argv[0], "--align") == 0) {
+            alignment = strtoull(argv[1], nullptr, 0);
+            argc -= 2;
+            argv += 2;
+        }
+        else if (strcmp(argv[0], "--watch") == 0) {
+            watching = true;
+            argc--;
+            argv++;
+        }
+        else if (strcmp(argv[0], "--atomic") == 0) {
+            atomic = true;
+            argc--;
+            argv++;
+        }
+        else {
+            break;
+        }
+    }
+    if (argc < 2 || alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        fprintf(stderr, "Usage:\n\tbin2elf --pack [--align power_of_two] [--watch [--atomic]] elf_file binary_file...\n");
+        exit(-1);
+    }
+
+    char* elf_file_name = argv[0];
+    auto blobs = std::vector<blob>(argc - 1);
+    if (1 + blobs.size() + 4 >= SHN_LORESERVE) {
+        fprintf(stderr, "too many binary files: %zu\n", blobs.size());
+        exit(-1);
+    }
+    for (size_t i = 0; i < blobs.size(); i++) {
+        blobs[i].path = argv[1 + i];
+    }
+    read_blobs(blobs);
+    for (auto& b : blobs) {
+        if (!b.read_ok) {
+            fprintf(stderr, "failed to read %s\n", b.path.c_str());
+            exit(-1);
+        }
+    }
+
+    auto object = layout_blobs(blobs, alignment);
+
+    if (watching) {
+        auto written = write_packed_file(elf_file_name, object, blobs);
+        return watch(elf_file_name, blobs, object, alignment, atomic, written);
+    }
+    FILE* elf_file = fopen(elf_file_name, "w");
+    assert(elf_file);
+    write_packed(elf_file, object, blobs);
+    fclose(elf_file);
+    return 0;
+}
+
+// a section-less executable that starts at the first byte of the first binary, further
+// binaries are loaded with it, in the order of the profile when one is given
+static int exec(int argc, char** argv)
+{
+    auto pie = false;
+    auto profile = elf64::build::layout_profile{};
+    while (argc >= 1 && strncmp(argv[0], "--", 2) == 0) {
+        if (strcmp(argv[0], "--pie") == 0) {
+            pie = true;
+            argc--;
+            argv++;
+        }
+        else if (argc >= 2 && strcmp(argv[0], "--profile") == 0) {
+            FILE* profile_file = fopen(argv[1], "r");
+            if (profile_file == nullptr) {
+                fprintf(stderr, "failed to read %s\n", argv[1]);
+                exit(-1);
+            }
+            profile = elf64::build::layout_profile::read_from(profile_file);
+            fclose(profile_file);
+            argc -= 2;
+            argv += 2;
+        }
+        else {
+            break;
+        }
+    }
+    if (argc < 2) {
+        fprintf(stderr, "Usage:\n\tbin2elf --exec [--pie] [--profile profile_file] binary_file elf_file [binary_file...]\n");
+        exit(-1);
+    }
+    char* elf_file_name = argv[1];
+    auto codes = std::vector<blob>{blob{.path = argv[0]}};
+    for (int i = 2; i < argc; i++) {
+        codes.push_back(blob{.path = argv[i]});
+    }
+    read_blobs(codes);
+    auto code_programs = std::vector<elf64::build::program>{};
+    for (auto& code : codes) {
+        if (!code.read_ok) {
+            fprintf(stderr, "failed to read %s\n", code.path.c_str());
+            exit(-1);
+        }
+        // programs are named by path, which is what the profile lists
+        code_programs.emplace_back(std::move(code.data), code.path);
+    }
+
+    auto code_segment = elf64::build::programs{std::move(code_programs)};
+    code_segment.set_layout_profile(std::move(profile));
+    auto executable = elf64::build::elf{
+        elf64::build::sections{},
+        std::move(code_segment)
+    };
+    executable.set_type(pie ? ET_DYN : ET_EXEC);
+    executable.set_base_address(pie ? 0 : 0x400000);
+    executable.set_minimal(true);
+    executable.set_entry(executable.program_address(0));
+    executable.set_name_section_index(SHN_UNDEF);
+
+    FILE* elf_file = fopen(elf_file_name, "w");
+    assert(elf_file);
+    executable.write_to(elf_file);
+    fclose(elf_file);
+    chmod(elf_file_name, 0755);
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
+    if (argc >= 2 && strcmp(argv[1], "--pack") == 0)
+    {
+        return pack(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--exec") == 0)
+    {
+        return exec(argc - 2, argv + 2);
+    }
     if (argc < 3)
     {
-        fprintf(stderr, "Usage:\n\tbin2elf binary_file elf_file\n");
+        fprintf(stderr, "Usage:\n\tbin2elf binary_file elf_file\n\tbin2elf --pack [--align power_of_two] [--watch [--atomic]] elf_file binary_file...\n\tbin2elf --exec [--pie] [--profile profile_file] binary_file elf_file [binary_file...]\n");
         exit(-1);
     }
 
@@ -32,7 +626,7 @@ int main(int argc, char** argv)
 
     auto allocator = elf64::linear_allocator{};
 
-    auto write_collect = std::vector<std::tuple<void*, size_t, size_t>>{};
+    auto write_collect = std::vector<std::tuple<const void*, size_t, size_t>>{};
 
     auto elf_header = elf64::elf_header{};
     auto elf_header_offset = allocator.allocate(sizeof(elf_header));
@@ -108,15 +702,8 @@ int main(int argc, char** argv)
     text_section.sh_type = SHT_PROGBITS;
     text_section.sh_flags = SHF_ALLOC | SHF_EXECINSTR;
 
-    auto symbol_table = std::vector<elf64::symbol>{
-        elf64::symbol{
-            .st_name = 0,
-            .st_info = 0,
-            .st_other= STV_DEFAULT,
-            .st_shndx= 0,
-            .st_value= 0,
-            .st_size = 0,
-        },
+    auto symbols = elf64::build::symbol_table_builder{};
+    symbols.add(
         elf64::symbol{
             .st_name = symbol_test_name_index,
             .st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC),
@@ -125,17 +712,17 @@ int main(int argc, char** argv)
             .st_value= 0,
             .st_size = 7,
         }
-    };
-    auto last_local_symbol_index = 0;
-    auto symbol_table_offset = allocator.allocate(sizeof(symbol_table[0])*symbol_table.size());
-    write_collect.emplace_back(symbol_table.data(), symbol_table_offset, sizeof(symbol_table[0])*symbol_table.size());
+    );
+    auto symbol_table = symbols.build();
+    auto symbol_table_offset = allocator.allocate(symbol_table.content_size());
+    write_collect.emplace_back(symbol_table.data(), symbol_table_offset, symbol_table.content_size());
 
     symbol_section.sh_offset = symbol_table_offset;
-    symbol_section.sh_size = sizeof(symbol_table[0]) * symbol_table.size();
+    symbol_section.sh_size = symbol_table.content_size();
     symbol_section.sh_type = SHT_SYMTAB;
-    symbol_section.sh_info = last_local_symbol_index+1;
+    symbol_section.sh_info = symbol_table.first_global_index();
     symbol_section.sh_link = symbol_name_section_index;
-    symbol_section.sh_entsize = sizeof(symbol_table[0]);
+    symbol_section.sh_entsize = sizeof(elf64::symbol);
 
     auto elf_header_helper = elf64::helper::elf_header{
         .type = ET_REL,
@@ -7,6 +7,8 @@
 #include <algorithm>
 #include <ranges>
 #include <iostream>
+#include <unordered_map>
+#include <span>
 
 #include "cpp_helper/cpp_helper.hpp"
 
@@ -40,6 +42,11 @@ namespace elf64 {
             m_next_address += size;
             return address;
         }
+        size_t allocate(size_t size, size_t alignment) {
+            assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+            m_next_address = (m_next_address + alignment - 1) & ~(alignment - 1);
+            return allocate(size);
+        }
     private:
         size_t m_next_address;
     };
@@ -158,11 +165,87 @@ namespace elf64 {
     }
 
     namespace build {
+
+    constexpr size_t page_size = 0x1000;
+
+    inline off align_up(off offset, size_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    // access weights for program names, hot programs are laid out first
+    class layout_profile {
+    public:
+        layout_profile() = default;
+        layout_profile(std::initializer_list<std::pair<const std::string, uint64_t>> weights) : m_weights{weights} {}
+        // one "name [weight]" per line, a missing weight counts as 1
+        static layout_profile read_from(FILE* file) {
+            auto profile = layout_profile{};
+            char line[4096+32];
+            char name[4096];
+            while (fgets(line, sizeof(line), file)) {
+                unsigned long long weight = 1;
+                auto count = sscanf(line, "%4095s %llu", name, &weight);
+                if (count >= 1 && name[0] != '#') {
+                    profile.m_weights[name] += weight;
+                }
+            }
+            return profile;
+        }
+        uint64_t weight(const std::string& name) const {
+            auto it = m_weights.find(name);
+            return it == m_weights.end() ? 0 : it->second;
+        }
+        bool empty() const {
+            return m_weights.empty();
+        }
+        // hot entries by descending weight, then cold ones in insertion order
+        auto order(const std::vector<std::string>& names) const {
+            auto indices = std::vector<size_t>(names.size());
+            std::iota(indices.begin(), indices.end(), 0);
+            auto weights = std::vector<uint64_t>(names.size());
+            std::ranges::transform(names, weights.begin(), [this](auto& name) { return weight(name); });
+            auto cold = std::ranges::stable_partition(indices, [&weights](auto i) { return weights[i] > 0; });
+            std::stable_sort(indices.begin(), cold.begin(), [&weights](auto a, auto b) { return weights[a] > weights[b]; });
+            auto hot_count = static_cast<size_t>(cold.begin() - indices.begin());
+            return std::pair{indices, hot_count};
+        }
+    private:
+        std::unordered_map<std::string, uint64_t> m_weights;
+    };
+
+    // places entries in profile order, the hot group and the cold group each start on a page,
+    // except a hot group that starts in the first page, which is loaded with the headers anyway
+    template<typename T>
+    off layout_in_profile_order(std::vector<T>& entries, const std::vector<std::string>& names, const layout_profile& profile, off offset) {
+        if (profile.empty()) {
+            for (auto& entry : entries) {
+                entry.set_offset(offset);
+                offset += entry.content_size();
+            }
+            return offset;
+        }
+        auto [order, hot_count] = profile.order(names);
+        for (size_t k = 0; k < order.size(); k++) {
+            if (hot_count > 0 && ((k == 0 && offset >= page_size) || k == hot_count)) {
+                offset = align_up(offset, page_size);
+            }
+            auto& entry = entries[order[k]];
+            entry.set_offset(offset);
+            offset += entry.content_size();
+        }
+        return offset;
+    }
     
     class symbol_table {
     public:
         symbol_table() = default;
-        symbol_table(std::initializer_list<symbol> symbols) : m_symbols{symbols} {}
+        symbol_table(std::initializer_list<symbol> symbols) : m_symbols{symbols} {
+            auto last_local = std::find_if(m_symbols.rbegin(), m_symbols.rend(), [](auto& sym) { return ELF64_ST_BIND(sym.st_info) == STB_LOCAL; });
+            m_first_global_index = m_symbols.rend() - last_local;
+        }
+        // symbols must already have every local before the first global
+        symbol_table(std::vector<symbol> symbols, size_t first_global_index)
+            : m_first_global_index{first_global_index}, m_symbols{std::move(symbols)} {}
         void set_offset(off offset){
             assert(offset != 0);
             m_offset = offset;
@@ -170,7 +253,7 @@ namespace elf64 {
         auto get_offset() {
             return m_offset;
         }
-        size_t content_size() {
+        size_t content_size() const {
             return m_symbols.size() * sizeof(symbol);
         }
         void write_to(FILE* file) {
@@ -188,9 +271,20 @@ namespace elf64 {
         auto entry_count() const {
             return m_symbols.size();
         }
+        // sh_info of SHT_SYMTAB: one greater than the index of the last local symbol
+        auto first_global_index() const {
+            return m_first_global_index;
+        }
+        auto data() const {
+            return m_symbols.data();
+        }
+        auto& operator[](size_t i) {
+            return m_symbols[i];
+        }
     private:
         size_t m_offset;
         size_t m_name_section_index;
+        size_t m_first_global_index = 0;
         std::vector<symbol> m_symbols;
     };
 
@@ -206,7 +300,7 @@ namespace elf64 {
                     );
 
         }
-        string_table(std::vector<std::string> strings) : m_strings{strings} {}
+        string_table(std::vector<std::string> strings) : m_strings{std::move(strings)} {}
         void set_offset(off offset){
             assert(offset != 0);
             m_offset = offset;
@@ -243,6 +337,80 @@ namespace elf64 {
         std::vector<std::string> m_strings;
     };
 
+    class symbol_table_builder {
+    public:
+        symbol_table_builder() : m_symbols(1) {}
+        void reserve(size_t count) {
+            m_symbols.reserve(count + 1);
+            m_names.reserve(count);
+        }
+        // returns the handle of the symbol, map it with index() after build()
+        size_t add(symbol sym) {
+            m_symbols.push_back(sym);
+            return m_symbols.size() - 1;
+        }
+        // st_name is set to the offset of name in names()
+        size_t add(std::string name, symbol sym) {
+            sym.st_name = m_name_offset;
+            m_name_offset += name.size() + 1;
+            m_names.push_back(std::move(name));
+            return add(sym);
+        }
+        // returns the handle of the first symbol, the rest follow consecutively
+        template<std::ranges::input_range R>
+            requires std::convertible_to<std::ranges::range_reference_t<R>, symbol>
+        size_t add_range(R&& symbols) {
+            auto first = m_symbols.size();
+            if constexpr (std::ranges::forward_range<R>) {
+                m_symbols.insert(m_symbols.end(), std::ranges::begin(symbols), std::ranges::end(symbols));
+            }
+            else {
+                std::ranges::copy(symbols, std::back_inserter(m_symbols));
+            }
+            return first;
+        }
+        // moves locals in front of globals in linear time, keeping the order within each group
+        symbol_table build() {
+            auto is_local = [](auto& sym) { return ELF64_ST_BIND(sym.st_info) == STB_LOCAL; };
+            auto symbols = std::vector<symbol>{};
+            symbols.reserve(m_symbols.size());
+            m_indices.resize(m_symbols.size());
+            for (size_t i = 0; i < m_symbols.size(); i++) {
+                if (is_local(m_symbols[i])) {
+                    m_indices[i] = symbols.size();
+                    symbols.push_back(m_symbols[i]);
+                }
+            }
+            auto local_count = symbols.size();
+            for (size_t i = 0; i < m_symbols.size(); i++) {
+                if (!is_local(m_symbols[i])) {
+                    m_indices[i] = symbols.size();
+                    symbols.push_back(m_symbols[i]);
+                }
+            }
+            m_symbols = {};
+            return symbol_table{std::move(symbols), local_count};
+        }
+        auto index(size_t handle) const {
+            return m_indices[handle];
+        }
+        // rewrites relocation symbol handles into final symbol indices
+        template<typename R>
+        void remap(std::span<R> relocations) const {
+            for (auto& rel : relocations) {
+                rel.r_info = ELF64_R_INFO(index(ELF64_R_SYM(rel.r_info)), ELF64_R_TYPE(rel.r_info));
+            }
+        }
+        auto names() const {
+            return string_table{m_names};
+        }
+    private:
+        std::vector<symbol> m_symbols;
+        std::vector<uint32_t> m_indices;
+        std::vector<std::string> m_names;
+        uint32_t m_name_offset = 1;
+    };
+
     class program_bits {
         program_bits() = default;
         program_bits(size_t offset) : m_program_offset{offset} {}
@@ -269,7 +437,7 @@ namespace elf64 {
     class section {
     public:
         section() = default;
-        section(std::variant<symbol_table, string_table>  content) : m_content{content} {}
+        section(std::variant<symbol_table, string_table>  content) : m_content{std::move(content)} {}
         void set_offset(off offset){
             assert(offset != 0);
             m_offset = offset;
@@ -285,7 +453,7 @@ namespace elf64 {
         }
         auto content_size() {
             return std::visit(
-                    [](auto content){
+                    [](auto& content){
                         return content.content_size();
                     },
                     m_content
@@ -342,6 +510,20 @@ namespace elf64 {
                     m_content
                     );
         }
+        auto info() {
+            return std::visit(
+                    cpp_helper::overloads{
+                        [](const symbol_table& content) -> size_t { return content.first_global_index(); },
+                        [](const string_table& content) -> size_t { return 0; }
+                    },
+                    m_content
+                    );
+        }
+        void set_name_section_index(size_t i) {
+            if (auto table = std::get_if<symbol_table>(&m_content)) {
+                table->set_name_section_index(i);
+            }
+        }
     private:
         off m_offset;
         std::variant<symbol_table, string_table> m_content;
@@ -351,6 +533,7 @@ namespace elf64 {
     public:
         program() = default;
         program(std::vector<uint8_t> binary_codes) : m_binary_codes{binary_codes} {}
+        program(std::vector<uint8_t> binary_codes, std::string name) : m_binary_codes{binary_codes}, m_name{name} {}
         void set_offset(off offset){
             assert(offset != 0);
             m_offset = offset;
@@ -370,9 +553,13 @@ namespace elf64 {
                 auto count = fwrite(m_binary_codes.data(), content_size(), 1, file);assert(count == 1);
             }
         }
+        auto& name() const {
+            return m_name;
+        }
     private:
         size_t m_offset;
         std::vector<uint8_t> m_binary_codes;
+        std::string m_name;
     };
 
     class sections {
@@ -380,7 +567,7 @@ namespace elf64 {
         sections() = default;
         sections(section sect) : m_sections{sect},m_name_indices(1) {}
         sections(std::initializer_list<section> sects) : m_sections{sects},m_name_indices(sects.size()) {}
-        sections(std::vector<section> sects) : m_sections{sects}, m_name_indices(sects.size()) {}
+        sections(std::vector<section> sects) : m_sections{std::move(sects)}, m_name_indices(m_sections.size()) {}
         void set_offset(off offset){
             assert(offset != 0);
             m_offset = offset;
@@ -418,7 +605,7 @@ namespace elf64 {
                 header.sh_offset = sect.get_offset();
                 header.sh_size = sect.content_size();
                 header.sh_link = sect.name_section_index();
-                header.sh_info = sect.entry_count();
+                header.sh_info = sect.info();
                 header.sh_addralign = 1;
                 header.sh_entsize = sect.entry_size();
                 auto count = fwrite(&header, sizeof(header), 1, file);assert(count == 1);
@@ -443,6 +630,18 @@ namespace elf64 {
         void set_name_index(size_t section_index, size_t i) {
             m_name_indices[section_index] = i;
         }
+        size_t push_back(section sect) {
+            m_sections.push_back(std::move(sect));
+            m_name_indices.push_back(0);
+            return m_sections.size() - 1;
+        }
+        // appends the symbol table followed by its string table and links them, returns the symbol table index
+        size_t add_symbol_table(symbol_table symbols, string_table names) {
+            auto index = push_back(section{std::move(symbols)});
+            auto names_index = push_back(section{std::move(names)});
+            m_sections[index].set_name_section_index(names_index);
+            return index;
+        }
     private:
         size_t m_offset;
         std::vector<section> m_sections;
@@ -457,40 +656,47 @@ namespace elf64 {
         void set_offset(off offset){
             assert(offset != 0);
             m_offset = offset;
-            offset += sizeof(program_header) * m_programs.size();
-            for (int i = 0; i < m_programs.size(); i++) {
-                auto& prog = m_programs[i];
-                prog.set_offset(offset);
-                offset = prog.next_offset();
-            }
+            offset += sizeof(program_header) * header_count();
+            auto names = std::vector<std::string>(m_programs.size());
+            std::ranges::transform(m_programs, names.begin(), [](auto& prog) { return prog.name(); });
+            m_end = layout_in_profile_order(m_programs, names, m_profile, offset);
         }
         auto get_offset() {
             return m_offset;
         }
         auto content_size() {
-            return std::transform_reduce(
-                    m_programs.begin(),
-                    m_programs.end(),
-                    sizeof(program_header)*m_programs.size(),
-                    std::plus<void>{},
-                    [](auto& prog) {
-                        return prog.content_size();
-                    }
-                    );
+            return m_end - m_offset;
         }
         auto next_offset() {
             return get_offset() + content_size();
         }
 
         void write_headers_to(FILE* file) {
-            for (int i = 0; i < m_programs.size(); i++) {
+            if (m_single_segment) {
+                program_header header{};
+                header.p_type = PT_LOAD;
+                header.p_flags = PF_X | PF_R;
+                header.p_offset = 0;
+                header.p_vaddr = m_base_address;
+                header.p_paddr = m_base_address;
+                header.p_filesz = m_end;
+                header.p_memsz = m_end;
+                header.p_align = page_size;
+                auto count = fwrite(&header, sizeof(header), 1, file);assert(count == 1);
+                return;
+            }
+            // PT_LOAD entries have to be sorted by address, which the profile may have reordered
+            auto order = std::vector<size_t>(m_programs.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::ranges::sort(order, {}, [this](auto i) { return m_programs[i].get_offset(); });
+            for (auto i : order) {
                 auto& prog = m_programs[i];
                 program_header header{};
                 header.p_type = PT_LOAD;
                 header.p_flags = PF_X | PF_R;
                 header.p_offset = prog.get_offset();
-                header.p_vaddr = 0x401000;
-                header.p_paddr = 0x401000;
+                header.p_vaddr = m_base_address + prog.get_offset();
+                header.p_paddr = m_base_address + prog.get_offset();
                 header.p_filesz = prog.content_size();
                 header.p_memsz = prog.content_size();
                 header.p_align = 0x1000;
@@ -512,9 +718,29 @@ namespace elf64 {
         auto size() {
             return m_programs.size();
         }
+        size_t header_count() {
+            return m_single_segment ? 1 : m_programs.size();
+        }
+        void set_layout_profile(layout_profile profile) {
+            m_profile = profile;
+        }
+        // one PT_LOAD from file offset 0, mapping the ELF and program headers together with every program
+        void set_single_segment(bool single_segment) {
+            m_single_segment = single_segment;
+        }
+        void set_base_address(addr base_address) {
+            m_base_address = base_address;
+        }
+        auto address(size_t program_index) {
+            return m_base_address + m_programs[program_index].get_offset();
+        }
     private:
+        addr m_base_address = 0x400000;
+        bool m_single_segment = false;
         size_t m_offset;
+        size_t m_end;
         std::vector<program> m_programs;
+        layout_profile m_profile;
     };
 
     class elf {
@@ -529,6 +755,10 @@ namespace elf64 {
         }
         void set_offset(size_t offset) {
             assert(offset == 0);
+            if (m_minimal) {
+                m_programs.set_offset(sizeof(elf_header));
+                return;
+            }
             m_sections.set_offset(sizeof(elf_header));
             m_programs.set_offset(m_sections.next_offset());
 
@@ -537,6 +767,9 @@ namespace elf64 {
             return 0;
         }
         auto content_size() {
+            if (m_minimal) {
+                return sizeof(elf_header) + m_programs.content_size();
+            }
             return sizeof(elf_header) + m_sections.content_size() + m_programs.content_size();
         }
         auto next_offset() {
@@ -558,22 +791,25 @@ namespace elf64 {
             elf_header.e_machine = EM_X86_64;
             elf_header.e_version = EV_CURRENT;
             elf_header.e_entry = m_entry;
-            elf_header.e_phoff = m_programs.get_offset();
-            elf_header.e_shoff = m_sections.get_offset();
+            auto has_sections = !m_minimal && m_sections.size() > 0;
+            elf_header.e_phoff = m_programs.header_count() > 0 ? m_programs.get_offset() : 0;
+            elf_header.e_shoff = has_sections ? m_sections.get_offset() : 0;
             elf_header.e_flags = 0;
             elf_header.e_ehsize = sizeof(elf_header);
             elf_header.e_phentsize = sizeof(program_header);
-            elf_header.e_phnum = m_programs.size();
-            elf_header.e_shentsize = sizeof(section_header);
-            elf_header.e_shnum = m_sections.size();
-            elf_header.e_shstrndx = m_section_string_section_index;
+            elf_header.e_phnum = m_programs.header_count();
+            elf_header.e_shentsize = has_sections ? sizeof(section_header) : 0;
+            elf_header.e_shnum = has_sections ? m_sections.size() : 0;
+            elf_header.e_shstrndx = has_sections ? m_section_string_section_index : SHN_UNDEF;
 
             fseek(file, 0, SEEK_SET);
             auto count = fwrite(&elf_header, sizeof(elf_header), 1, file);assert(count == 1);
         }
         void write_to(FILE* file) {
             write_header_to(file);
-            m_sections.write_to(file);
+            if (!m_minimal) {
+                m_sections.write_to(file);
+            }
             m_programs.write_to(file);
         }
         void set_name_section_index(uint32_t i) {
@@ -585,7 +821,22 @@ namespace elf64 {
         void set_entry(addr entry_addr) {
             m_entry = entry_addr;
         }
+        // drops the section header table and all non-loaded data, the headers share the
+        // first loaded page with the programs, giving the smallest image exec accepts
+        void set_minimal(bool minimal) {
+            m_minimal = minimal;
+            m_programs.set_single_segment(minimal);
+            set_offset(0);
+        }
+        // 0 for ET_DYN, which the kernel relocates
+        void set_base_address(addr base_address) {
+            m_programs.set_base_address(base_address);
+        }
+        auto program_address(size_t program_index) {
+            return m_programs.address(program_index);
+        }
     private:
+        bool m_minimal = false;
         uint16_t m_type;
         addr m_entry;
         uint32_t m_section_string_section_index;
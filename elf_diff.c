@@ -0,0 +1,302 @@
+#include <elf.h>
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "elf_reader.h"
+
+/* compares two ELF files section by section, exits with 0 when they match,
+ * 1 when they differ and 2 on errors, like cmp */
+
+struct mapped_elf
+{
+    const char* path;
+    FILE* file;
+    struct elf_reader reader;
+    const unsigned char* data;
+    size_t size;
+};
+
+static int differences = 0;
+
+static int map_elf(struct mapped_elf* elf, const char* path)
+{
+    elf->path = path;
+    elf->file = fopen(path, "r");
+    if (elf->file == NULL || elf_reader_open(&elf->reader, elf->file) != 0)
+    {
+        return -1;
+    }
+    struct stat status;
+    if (fstat(fileno(elf->file), &status) != 0)
+    {
+        return -1;
+    }
+    elf->size = status.st_size;
+    elf->data = NULL;
+    if (elf->size > 0)
+    {
+        void* data = mmap(NULL, elf->size, PROT_READ, MAP_PRIVATE, fileno(elf->file), 0);
+        if (data == MAP_FAILED)
+        {
+            return -1;
+        }
+        madvise(data, elf->size, MADV_SEQUENTIAL);
+        elf->data = data;
+    }
+    return 0;
+}
+
+static void unmap_elf(struct mapped_elf* elf)
+{
+    if (elf->data)
+    {
+        munmap((void*)elf->data, elf->size);
+    }
+    elf_reader_close(&elf->reader);
+    fclose(elf->file);
+}
+
+static void report_field(const char* what, const char* field, uint64_t old_value, uint64_t new_value)
+{
+    if (old_value != new_value)
+    {
+        printf("%s %s : 0x%lx 0x%lx\n", what, field, old_value, new_value);
+        differences++;
+    }
+}
+
+static void prefetch(const struct mapped_elf* elf, uint64_t offset, uint64_t size)
+{
+    uint64_t page = offset & ~(uint64_t)4095;
+    madvise((void*)(elf->data + page), offset + size - page, MADV_WILLNEED);
+}
+
+/* returns the first differing offset, or size when the ranges are equal */
+static uint64_t first_difference(const unsigned char* a, const unsigned char* b, uint64_t size,
+    const struct mapped_elf* old_elf, uint64_t old_offset, const struct mapped_elf* new_elf, uint64_t new_offset)
+{
+    const uint64_t chunk = 1 << 20;
+    const uint64_t ahead = 8 * chunk;
+    for (uint64_t done = 0; done < size; done += chunk)
+    {
+        /* keep both files reading ahead, which overlaps the I/O when they are on different devices */
+        if (done % ahead == 0 && size - done > chunk)
+        {
+            uint64_t length = size - done < ahead ? size - done : ahead;
+            prefetch(old_elf, old_offset + done, length);
+            prefetch(new_elf, new_offset + done, length);
+        }
+        uint64_t length = size - done < chunk ? size - done : chunk;
+        if (memcmp(a + done, b + done, length) == 0)
+        {
+            continue;
+        }
+        uint64_t i = done;
+        for (uint64_t step = 64; i + step <= done + length && memcmp(a + i, b + i, step) == 0; i += step)
+        {
+        }
+        while (a[i] == b[i])
+        {
+            i++;
+        }
+        return i;
+    }
+    return size;
+}
+
+static void compare_contents(const char* what, const struct mapped_elf* old_elf, uint64_t old_offset, uint64_t old_size,
+    const struct mapped_elf* new_elf, uint64_t new_offset, uint64_t new_size)
+{
+    if (old_offset + old_size > old_elf->size || new_offset + new_size > new_elf->size)
+    {
+        printf("%s : contents out of file\n", what);
+        differences++;
+        return;
+    }
+    uint64_t size = old_size < new_size ? old_size : new_size;
+    uint64_t offset = size == 0 ? 0 : first_difference(old_elf->data + old_offset, new_elf->data + new_offset, size,
+        old_elf, old_offset, new_elf, new_offset);
+    if (offset < size || old_size != new_size)
+    {
+        printf("%s : first difference at offset 0x%lx\n", what, offset);
+        differences++;
+    }
+}
+
+static void compare_headers(const Elf64_Ehdr* a, const Elf64_Ehdr* b)
+{
+    if (memcmp(a->e_ident, b->e_ident, EI_NIDENT) != 0)
+    {
+        printf("header ident : differs\n");
+        differences++;
+    }
+    report_field("header", "type", a->e_type, b->e_type);
+    report_field("header", "machine", a->e_machine, b->e_machine);
+    report_field("header", "version", a->e_version, b->e_version);
+    report_field("header", "entry", a->e_entry, b->e_entry);
+    report_field("header", "flags", a->e_flags, b->e_flags);
+    report_field("header", "program header number", a->e_phnum, b->e_phnum);
+    report_field("header", "section header number", a->e_shnum, b->e_shnum);
+    report_field("header", "name string section index", a->e_shstrndx, b->e_shstrndx);
+    report_field("header", "header size", a->e_ehsize, b->e_ehsize);
+    report_field("header", "program header size", a->e_phentsize, b->e_phentsize);
+    report_field("header", "section header size", a->e_shentsize, b->e_shentsize);
+}
+
+/* matches by name and type, duplicated names are paired in order */
+static int match_section(const struct elf_reader* reader, const char* name, uint32_t type, const char* used)
+{
+    int i = elf_reader_find_section(reader, name);
+    if (i >= 0 && reader->sections[i].sh_type == type && !used[i])
+    {
+        return i;
+    }
+    for (i = 0; i < reader->header.e_shnum; i++)
+    {
+        const char* other = elf_reader_section_name(reader, i);
+        if (!used[i] && reader->sections[i].sh_type == type && other && strcmp(other, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void compare_sections(const struct mapped_elf* old_elf, const struct mapped_elf* new_elf)
+{
+    const struct elf_reader* a = &old_elf->reader;
+    const struct elf_reader* b = &new_elf->reader;
+    char* used = calloc(b->header.e_shnum + 1, 1);
+    assert(used);
+    char what[512];
+    for (int i = 1; i < a->header.e_shnum; i++)
+    {
+        const char* name = elf_reader_section_name(a, i);
+        name = name ? name : "";
+        const Elf64_Shdr* old_section = &a->sections[i];
+        snprintf(what, sizeof(what), "section %s", name);
+        int j = match_section(b, name, old_section->sh_type, used);
+        if (j < 0)
+        {
+            printf("%s : only in %s\n", what, old_elf->path);
+            differences++;
+            continue;
+        }
+        used[j] = 1;
+        const Elf64_Shdr* new_section = &b->sections[j];
+        /* sh_name and sh_offset only locate the name and contents, which are compared directly */
+        report_field(what, "flags", old_section->sh_flags, new_section->sh_flags);
+        report_field(what, "addr", old_section->sh_addr, new_section->sh_addr);
+        report_field(what, "size", old_section->sh_size, new_section->sh_size);
+        report_field(what, "link", old_section->sh_link, new_section->sh_link);
+        report_field(what, "info", old_section->sh_info, new_section->sh_info);
+        report_field(what, "addralign", old_section->sh_addralign, new_section->sh_addralign);
+        report_field(what, "entsize", old_section->sh_entsize, new_section->sh_entsize);
+        if (old_section->sh_type != SHT_NOBITS)
+        {
+            compare_contents(what, old_elf, old_section->sh_offset, old_section->sh_size,
+                new_elf, new_section->sh_offset, new_section->sh_size);
+        }
+    }
+    for (int j = 1; j < b->header.e_shnum; j++)
+    {
+        if (!used[j])
+        {
+            const char* name = elf_reader_section_name(b, j);
+            printf("section %s : only in %s\n", name ? name : "", new_elf->path);
+            differences++;
+        }
+    }
+    free(used);
+}
+
+static const Elf64_Phdr* program_headers(const struct mapped_elf* elf)
+{
+    const Elf64_Ehdr* header = &elf->reader.header;
+    if (header->e_phnum == 0 || header->e_phentsize != sizeof(Elf64_Phdr)
+        || header->e_phoff + (uint64_t)header->e_phnum * sizeof(Elf64_Phdr) > elf->size)
+    {
+        return NULL;
+    }
+    return (const Elf64_Phdr*)(elf->data + header->e_phoff);
+}
+
+/* segments are matched by type and their order among segments of that type,
+ * their contents are compared too since they are what gets loaded, even where sections cover them */
+static void compare_segments(const struct mapped_elf* old_elf, const struct mapped_elf* new_elf)
+{
+    const Elf64_Phdr* a = program_headers(old_elf);
+    const Elf64_Phdr* b = program_headers(new_elf);
+    int a_count = a ? old_elf->reader.header.e_phnum : 0;
+    int b_count = b ? new_elf->reader.header.e_phnum : 0;
+    char* used = calloc(b_count + 1, 1);
+    assert(used);
+    char what[64];
+    for (int i = 0; i < a_count; i++)
+    {
+        snprintf(what, sizeof(what), "segment %d (type 0x%x)", i, a[i].p_type);
+        int j = 0;
+        while (j < b_count && (used[j] || b[j].p_type != a[i].p_type))
+        {
+            j++;
+        }
+        if (j == b_count)
+        {
+            printf("%s : only in %s\n", what, old_elf->path);
+            differences++;
+            continue;
+        }
+        used[j] = 1;
+        report_field(what, "flags", a[i].p_flags, b[j].p_flags);
+        report_field(what, "offset", a[i].p_offset, b[j].p_offset);
+        report_field(what, "vaddr", a[i].p_vaddr, b[j].p_vaddr);
+        report_field(what, "paddr", a[i].p_paddr, b[j].p_paddr);
+        report_field(what, "filesz", a[i].p_filesz, b[j].p_filesz);
+        report_field(what, "memsz", a[i].p_memsz, b[j].p_memsz);
+        report_field(what, "align", a[i].p_align, b[j].p_align);
+        compare_contents(what, old_elf, a[i].p_offset, a[i].p_filesz, new_elf, b[j].p_offset, b[j].p_filesz);
+    }
+    for (int j = 0; j < b_count; j++)
+    {
+        if (!used[j])
+        {
+            printf("segment %d (type 0x%x) : only in %s\n", j, b[j].p_type, new_elf->path);
+            differences++;
+        }
+    }
+    free(used);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage:\n\telf_diff old_elf_file new_elf_file\n");
+        exit(2);
+    }
+    struct mapped_elf old_elf;
+    struct mapped_elf new_elf;
+    if (map_elf(&old_elf, argv[1]) != 0)
+    {
+        fprintf(stderr, "failed to read %s\n", argv[1]);
+        exit(2);
+    }
+    if (map_elf(&new_elf, argv[2]) != 0)
+    {
+        fprintf(stderr, "failed to read %s\n", argv[2]);
+        exit(2);
+    }
+
+    compare_headers(&old_elf.reader.header, &new_elf.reader.header);
+    compare_sections(&old_elf, &new_elf);
+    compare_segments(&old_elf, &new_elf);
+
+    unmap_elf(&old_elf);
+    unmap_elf(&new_elf);
+    return differences ? 1 : 0;
+}
@@ -0,0 +1,292 @@
+#define _GNU_SOURCE
+#include "elf_notes.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static ssize_t read_full(int fd, void* buffer, size_t size, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t count = pread(fd, (char*)buffer + done, size - done, offset + done);
+        if (count < 0)
+        {
+            return -1;
+        }
+        if (count == 0)
+        {
+            break;
+        }
+        done += count;
+    }
+    return done;
+}
+
+int elf_note_stream_open(struct elf_note_stream* stream, int fd, const Elf64_Ehdr* header, size_t window_capacity)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->fd = fd;
+    stream->program_index = -1;
+    if (header->e_phnum == 0)
+    {
+        return 0;
+    }
+    if (header->e_phentsize != sizeof(Elf64_Phdr) || window_capacity < sizeof(Elf64_Nhdr))
+    {
+        return -1;
+    }
+    size_t programs_size = (size_t)header->e_phnum * sizeof(Elf64_Phdr);
+    stream->programs = malloc(programs_size);
+    stream->window = malloc(window_capacity);
+    if (stream->programs == NULL || stream->window == NULL
+        || read_full(fd, stream->programs, programs_size, header->e_phoff) != (ssize_t)programs_size)
+    {
+        elf_note_stream_close(stream);
+        return -1;
+    }
+    stream->program_count = header->e_phnum;
+    stream->window_capacity = window_capacity;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
+void elf_note_stream_close(struct elf_note_stream* stream)
+{
+    free(stream->programs);
+    free(stream->window);
+    stream->programs = NULL;
+    stream->window = NULL;
+}
+
+/* returns size bytes at offset, refilling the window and hinting the kernel to read the next one */
+static const unsigned char* window_at(struct elf_note_stream* stream, uint64_t offset, size_t size)
+{
+    if (offset >= stream->window_offset && offset + size <= stream->window_offset + stream->window_size)
+    {
+        return stream->window + (offset - stream->window_offset);
+    }
+    size_t want = stream->window_capacity;
+    if (want > stream->segment_end - offset)
+    {
+        want = stream->segment_end - offset;
+    }
+    ssize_t count = read_full(stream->fd, stream->window, want, offset);
+    if (count < 0 || (size_t)count < size)
+    {
+        stream->window_size = 0;
+        return NULL;
+    }
+    stream->window_offset = offset;
+    stream->window_size = count;
+    posix_fadvise(stream->fd, offset + count, stream->window_capacity, POSIX_FADV_WILLNEED);
+    return stream->window;
+}
+
+static int next_segment(struct elf_note_stream* stream)
+{
+    while (++stream->program_index < stream->program_count)
+    {
+        const Elf64_Phdr* program = &stream->programs[stream->program_index];
+        if (program->p_type == PT_NOTE)
+        {
+            stream->position = program->p_offset;
+            stream->segment_end = program->p_offset + program->p_filesz;
+            stream->alignment = program->p_align == 8 ? 8 : 4;
+            stream->window_size = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int elf_note_stream_next(struct elf_note_stream* stream, struct elf_note* note)
+{
+    while (stream->program_index < 0 || stream->position + sizeof(Elf64_Nhdr) > stream->segment_end)
+    {
+        if (!next_segment(stream))
+        {
+            return 0;
+        }
+    }
+
+    const unsigned char* data = window_at(stream, stream->position, sizeof(Elf64_Nhdr));
+    if (data == NULL)
+    {
+        return -1;
+    }
+    Elf64_Nhdr header;
+    memcpy(&header, data, sizeof(header));
+    uint64_t desc_start = align_up(sizeof(header) + header.n_namesz, stream->alignment);
+    uint64_t desc_end = desc_start + header.n_descsz;
+    if (stream->position + desc_end > stream->segment_end || desc_start > stream->window_capacity)
+    {
+        return -1;
+    }
+
+    int desc_fits = desc_end <= stream->window_capacity;
+    data = window_at(stream, stream->position, desc_fits ? desc_end : desc_start);
+    if (data == NULL)
+    {
+        return -1;
+    }
+    note->type = header.n_type;
+    note->name_size = header.n_namesz;
+    note->name = header.n_namesz > 0 ? (const char*)data + sizeof(header) : "";
+    note->desc_offset = stream->position + desc_start;
+    note->desc_size = header.n_descsz;
+    note->desc = desc_fits ? data + desc_start : NULL;
+
+    uint64_t next = stream->position + align_up(desc_end, stream->alignment);
+    stream->position = next < stream->segment_end ? next : stream->segment_end;
+    return 1;
+}
+
+int elf_note_prstatus(const struct elf_note* note, struct elf_prstatus* prstatus)
+{
+    if (note->type != NT_PRSTATUS || note->desc == NULL || note->desc_size < sizeof(*prstatus))
+    {
+        return -1;
+    }
+    memcpy(prstatus, note->desc, sizeof(*prstatus));
+    return 0;
+}
+
+/* sequential reader over a descriptor with a small private buffer */
+struct desc_cursor
+{
+    int fd;
+    uint64_t next;
+    uint64_t end;
+    uint64_t buffer_offset;
+    size_t buffer_size;
+    unsigned char buffer[4096];
+};
+
+static void cursor_init(struct desc_cursor* cursor, int fd, uint64_t offset, uint64_t end)
+{
+    cursor->fd = fd;
+    cursor->next = offset;
+    cursor->end = end;
+    cursor->buffer_offset = offset;
+    cursor->buffer_size = 0;
+}
+
+static int cursor_refill(struct desc_cursor* cursor)
+{
+    size_t want = sizeof(cursor->buffer);
+    if (want > cursor->end - cursor->next)
+    {
+        want = cursor->end - cursor->next;
+    }
+    ssize_t count = read_full(cursor->fd, cursor->buffer, want, cursor->next);
+    if (count <= 0)
+    {
+        return -1;
+    }
+    cursor->buffer_offset = cursor->next;
+    cursor->buffer_size = count;
+    return 0;
+}
+
+static int cursor_read(struct desc_cursor* cursor, void* out, size_t size)
+{
+    if (cursor->next + size > cursor->end)
+    {
+        return -1;
+    }
+    if (cursor->next + size > cursor->buffer_offset + cursor->buffer_size
+        && (cursor_refill(cursor) != 0 || cursor->buffer_size < size))
+    {
+        return -1;
+    }
+    memcpy(out, cursor->buffer + (cursor->next - cursor->buffer_offset), size);
+    cursor->next += size;
+    return 0;
+}
+
+/* strings longer than the output are truncated */
+static int cursor_read_string(struct desc_cursor* cursor, char* out, size_t capacity)
+{
+    size_t length = 0;
+    for (;;)
+    {
+        if (cursor->next >= cursor->end)
+        {
+            return -1;
+        }
+        if (cursor->next >= cursor->buffer_offset + cursor->buffer_size && cursor_refill(cursor) != 0)
+        {
+            return -1;
+        }
+        const unsigned char* begin = cursor->buffer + (cursor->next - cursor->buffer_offset);
+        size_t available = cursor->buffer_offset + cursor->buffer_size - cursor->next;
+        const unsigned char* nul = memchr(begin, '\0', available);
+        size_t count = nul ? (size_t)(nul - begin) : available;
+        size_t copy = count < capacity - 1 - length ? count : capacity - 1 - length;
+        memcpy(out + length, begin, copy);
+        length += copy;
+        cursor->next += count;
+        if (nul)
+        {
+            cursor->next++;
+            out[length] = '\0';
+            return 0;
+        }
+    }
+}
+
+int elf_note_auxv(int fd, const struct elf_note* note,
+    void (*callback)(void* context, uint64_t type, uint64_t value), void* context)
+{
+    if (note->type != NT_AUXV)
+    {
+        return -1;
+    }
+    struct desc_cursor cursor;
+    cursor_init(&cursor, fd, note->desc_offset, note->desc_offset + note->desc_size);
+    Elf64_auxv_t entry;
+    while (cursor_read(&cursor, &entry, sizeof(entry)) == 0 && entry.a_type != AT_NULL)
+    {
+        callback(context, entry.a_type, entry.a_un.a_val);
+    }
+    return 0;
+}
+
+int elf_note_file_mappings(int fd, const struct elf_note* note,
+    void (*callback)(void* context, uint64_t start, uint64_t end, uint64_t file_offset, const char* path), void* context)
+{
+    if (note->type != NT_FILE)
+    {
+        return -1;
+    }
+    uint64_t desc_end = note->desc_offset + note->desc_size;
+    struct desc_cursor entries;
+    cursor_init(&entries, fd, note->desc_offset, desc_end);
+    uint64_t counts[2]; /* mapping count, page size */
+    if (cursor_read(&entries, counts, sizeof(counts)) != 0 || counts[0] > (note->desc_size - sizeof(counts)) / (3 * sizeof(uint64_t)))
+    {
+        return -1;
+    }
+    struct desc_cursor names;
+    cursor_init(&names, fd, note->desc_offset + sizeof(counts) + counts[0] * 3 * sizeof(uint64_t), desc_end);
+    char path[PATH_MAX];
+    for (uint64_t i = 0; i < counts[0]; i++)
+    {
+        uint64_t mapping[3]; /* start, end, offset in pages */
+        if (cursor_read(&entries, mapping, sizeof(mapping)) != 0 || cursor_read_string(&names, path, sizeof(path)) != 0)
+        {
+            return -1;
+        }
+        callback(context, mapping[0], mapping[1], mapping[2] * counts[1], path);
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <elf.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/procfs.h>
+
+/* iterates the notes of every PT_NOTE segment through a fixed size window,
+ * so memory use does not depend on the size of the segments */
+struct elf_note_stream
+{
+    int fd;
+    Elf64_Phdr* programs;
+    int program_count;
+    int program_index;
+    uint64_t alignment;
+    uint64_t position;
+    uint64_t segment_end;
+    unsigned char* window;
+    size_t window_capacity;
+    uint64_t window_offset;
+    size_t window_size;
+};
+
+struct elf_note
+{
+    uint32_t type;
+    const char* name; /* valid until the next call on the stream */
+    uint32_t name_size;
+    uint64_t desc_offset; /* file offset of the descriptor */
+    uint64_t desc_size;
+    const unsigned char* desc; /* NULL when the descriptor does not fit in the window */
+};
+
+int elf_note_stream_open(struct elf_note_stream* stream, int fd, const Elf64_Ehdr* header, size_t window_capacity);
+void elf_note_stream_close(struct elf_note_stream* stream);
+/* returns 1 for a note, 0 at the end, -1 on a read error or a malformed note */
+int elf_note_stream_next(struct elf_note_stream* stream, struct elf_note* note);
+
+/* descriptor decoders, these read large descriptors in small chunks */
+int elf_note_prstatus(const struct elf_note* note, struct elf_prstatus* prstatus);
+int elf_note_auxv(int fd, const struct elf_note* note,
+    void (*callback)(void* context, uint64_t type, uint64_t value), void* context);
+int elf_note_file_mappings(int fd, const struct elf_note* note,
+    void (*callback)(void* context, uint64_t start, uint64_t end, uint64_t file_offset, const char* path), void* context);
@@ -0,0 +1,445 @@
+#include "elf_reader.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t elf_gnu_hash(const char* name)
+{
+    uint32_t hash = 5381;
+    for (const unsigned char* c = (const unsigned char*)name; *c; c++)
+    {
+        hash = hash * 33 + *c;
+    }
+    return hash;
+}
+
+uint32_t elf_sysv_hash(const char* name)
+{
+    uint32_t hash = 0;
+    for (const unsigned char* c = (const unsigned char*)name; *c; c++)
+    {
+        hash = (hash << 4) + *c;
+        uint32_t high = hash & 0xf0000000;
+        if (high)
+        {
+            hash ^= high >> 24;
+        }
+        hash &= ~high;
+    }
+    return hash;
+}
+
+static void* read_range(FILE* file, uint64_t offset, uint64_t size)
+{
+    void* data = malloc(size > 0 ? size : 1);
+    if (data == NULL)
+    {
+        return NULL;
+    }
+    if (size > 0 && (fseek(file, offset, SEEK_SET) != 0 || fread(data, size, 1, file) != 1))
+    {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+static const char* string_at(const char* strings, size_t strings_size, uint32_t offset)
+{
+    if (strings == NULL || offset >= strings_size || memchr(strings + offset, '\0', strings_size - offset) == NULL)
+    {
+        return NULL;
+    }
+    return strings + offset;
+}
+
+static int name_index_init(struct elf_name_index* index, size_t count)
+{
+    size_t capacity = 8;
+    while (capacity < count * 2)
+    {
+        capacity *= 2;
+    }
+    index->slots = calloc(capacity, sizeof(index->slots[0]));
+    index->mask = capacity - 1;
+    return index->slots ? 0 : -1;
+}
+
+/* the first entry inserted under a name wins */
+static void name_index_insert(struct elf_name_index* index, const char* strings, uint32_t name, uint32_t entry)
+{
+    const char* str = strings + name;
+    uint32_t hash = elf_gnu_hash(str);
+    size_t length = strlen(str) + 1;
+    for (uint32_t i = hash & index->mask;; i = (i + 1) & index->mask)
+    {
+        struct elf_name_slot* slot = &index->slots[i];
+        if (slot->entry == 0)
+        {
+            slot->hash = hash;
+            slot->name = name;
+            slot->entry = entry + 1;
+            return;
+        }
+        if (slot->hash == hash && memcmp(strings + slot->name, str, length) == 0)
+        {
+            return;
+        }
+    }
+}
+
+static int name_index_find(const struct elf_name_index* index, const char* strings, size_t strings_size, const char* name, uint32_t hash, size_t length)
+{
+    if (index->slots == NULL)
+    {
+        return -1;
+    }
+    for (uint32_t i = hash & index->mask;; i = (i + 1) & index->mask)
+    {
+        const struct elf_name_slot* slot = &index->slots[i];
+        if (slot->entry == 0)
+        {
+            return -1;
+        }
+        if (slot->hash == hash && slot->name + length <= strings_size && memcmp(strings + slot->name, name, length) == 0)
+        {
+            return slot->entry - 1;
+        }
+    }
+}
+
+static int build_section_index(struct elf_reader* reader)
+{
+    if (name_index_init(&reader->section_index, reader->header.e_shnum) != 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < reader->header.e_shnum; i++)
+    {
+        if (elf_reader_section_name(reader, i))
+        {
+            name_index_insert(&reader->section_index, reader->section_names, reader->sections[i].sh_name, i);
+        }
+    }
+    return 0;
+}
+
+static int build_symbol_index(struct elf_symbol_table* table)
+{
+    if (name_index_init(&table->index, table->count) != 0)
+    {
+        return -1;
+    }
+    /* globals first, so that a local symbol never hides a global one */
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (size_t i = 1; i < table->count; i++)
+        {
+            const Elf64_Sym* symbol = &table->symbols[i];
+            int is_local = ELF64_ST_BIND(symbol->st_info) == STB_LOCAL;
+            if (is_local != pass || symbol->st_name == 0
+                || string_at(table->names, table->names_size, symbol->st_name) == NULL)
+            {
+                continue;
+            }
+            name_index_insert(&table->index, table->names, symbol->st_name, i);
+        }
+    }
+    return 0;
+}
+
+static int load_symbol_table(struct elf_reader* reader, struct elf_symbol_table* table, int section_index)
+{
+    const Elf64_Shdr* section = &reader->sections[section_index];
+    if (section->sh_entsize != sizeof(Elf64_Sym) || section->sh_link >= reader->header.e_shnum)
+    {
+        return -1;
+    }
+    const Elf64_Shdr* names = &reader->sections[section->sh_link];
+    table->count = section->sh_size / sizeof(Elf64_Sym);
+    table->symbols = read_range(reader->file, section->sh_offset, section->sh_size);
+    table->names_size = names->sh_size;
+    table->names = read_range(reader->file, names->sh_offset, names->sh_size);
+    return table->symbols && table->names ? 0 : -1;
+}
+
+static int load_hash_tables(struct elf_reader* reader, int dynamic_symbol_section)
+{
+    for (int i = 0; i < reader->header.e_shnum; i++)
+    {
+        const Elf64_Shdr* section = &reader->sections[i];
+        if (section->sh_link != dynamic_symbol_section)
+        {
+            continue;
+        }
+        struct elf_symbol_table* table = &reader->dynamic_symbols;
+        if (section->sh_type == SHT_GNU_HASH && table->gnu_hash == NULL)
+        {
+            table->gnu_hash_words = section->sh_size / sizeof(uint32_t);
+            table->gnu_hash = read_range(reader->file, section->sh_offset, section->sh_size);
+            if (table->gnu_hash == NULL)
+            {
+                return -1;
+            }
+        }
+        else if (section->sh_type == SHT_HASH && table->sysv_hash == NULL)
+        {
+            table->sysv_hash_words = section->sh_size / sizeof(uint32_t);
+            table->sysv_hash = read_range(reader->file, section->sh_offset, section->sh_size);
+            if (table->sysv_hash == NULL)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void free_symbol_table(struct elf_symbol_table* table)
+{
+    free(table->symbols);
+    free(table->names);
+    free(table->gnu_hash);
+    free(table->sysv_hash);
+    free(table->index.slots);
+    memset(table, 0, sizeof(*table));
+}
+
+static int load_sections(struct elf_reader* reader, FILE* file)
+{
+    reader->file = file;
+    if (fseek(file, 0, SEEK_SET) != 0 || fread(&reader->header, sizeof(reader->header), 1, file) != 1)
+    {
+        return -1;
+    }
+    const Elf64_Ehdr* header = &reader->header;
+    if (header->e_ident[EI_MAG0] != 0x7f || header->e_ident[EI_MAG1] != 'E' || header->e_ident[EI_MAG2] != 'L' || header->e_ident[EI_MAG3] != 'F'
+        || header->e_ident[EI_CLASS] != ELFCLASS64)
+    {
+        return -1;
+    }
+    if (header->e_shnum == 0)
+    {
+        return 0;
+    }
+    if (header->e_shentsize != sizeof(Elf64_Shdr))
+    {
+        return -1;
+    }
+    reader->sections = read_range(file, header->e_shoff, (uint64_t)header->e_shnum * sizeof(Elf64_Shdr));
+    if (reader->sections == NULL)
+    {
+        return -1;
+    }
+    if (header->e_shstrndx != SHN_UNDEF && header->e_shstrndx < header->e_shnum)
+    {
+        const Elf64_Shdr* names = &reader->sections[header->e_shstrndx];
+        reader->section_names_size = names->sh_size;
+        reader->section_names = read_range(file, names->sh_offset, names->sh_size);
+        if (reader->section_names == NULL)
+        {
+            return -1;
+        }
+    }
+    if (build_section_index(reader) != 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int elf_reader_open(struct elf_reader* reader, FILE* file)
+{
+    memset(reader, 0, sizeof(*reader));
+    if (load_sections(reader, file) != 0)
+    {
+        elf_reader_close(reader);
+        return -1;
+    }
+    return 0;
+}
+
+static int load_symbols(struct elf_reader* reader)
+{
+    for (int i = 0; i < reader->header.e_shnum; i++)
+    {
+        uint32_t type = reader->sections[i].sh_type;
+        if (type == SHT_DYNSYM && reader->dynamic_symbols.symbols == NULL)
+        {
+            if (load_symbol_table(reader, &reader->dynamic_symbols, i) != 0 || load_hash_tables(reader, i) != 0)
+            {
+                return -1;
+            }
+            if (reader->dynamic_symbols.gnu_hash == NULL && reader->dynamic_symbols.sysv_hash == NULL
+                && build_symbol_index(&reader->dynamic_symbols) != 0)
+            {
+                return -1;
+            }
+        }
+        else if (type == SHT_SYMTAB && reader->symbols.symbols == NULL)
+        {
+            if (load_symbol_table(reader, &reader->symbols, i) != 0 || build_symbol_index(&reader->symbols) != 0)
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int elf_reader_load_symbols(struct elf_reader* reader)
+{
+    if (reader->symbols_loaded != 0)
+    {
+        return reader->symbols_loaded > 0 ? 0 : -1;
+    }
+    if (load_symbols(reader) != 0)
+    {
+        free_symbol_table(&reader->dynamic_symbols);
+        free_symbol_table(&reader->symbols);
+        reader->symbols_loaded = -1;
+        return -1;
+    }
+    reader->symbols_loaded = 1;
+    return 0;
+}
+
+void elf_reader_close(struct elf_reader* reader)
+{
+    free(reader->sections);
+    free(reader->section_names);
+    free(reader->section_index.slots);
+    free_symbol_table(&reader->dynamic_symbols);
+    free_symbol_table(&reader->symbols);
+    memset(reader, 0, sizeof(*reader));
+}
+
+const char* elf_reader_section_name(const struct elf_reader* reader, int section_index)
+{
+    if (section_index < 0 || section_index >= reader->header.e_shnum)
+    {
+        return NULL;
+    }
+    return string_at(reader->section_names, reader->section_names_size, reader->sections[section_index].sh_name);
+}
+
+int elf_reader_find_section(const struct elf_reader* reader, const char* name)
+{
+    return name_index_find(&reader->section_index, reader->section_names, reader->section_names_size,
+        name, elf_gnu_hash(name), strlen(name) + 1);
+}
+
+static int symbol_name_equals(const struct elf_symbol_table* table, size_t symbol_index, const char* name, size_t length)
+{
+    uint32_t offset = table->symbols[symbol_index].st_name;
+    return offset + length <= table->names_size && memcmp(table->names + offset, name, length) == 0;
+}
+
+static const Elf64_Sym* gnu_hash_find(const struct elf_symbol_table* table, const char* name, uint32_t hash, size_t length)
+{
+    const uint32_t* words = table->gnu_hash;
+    if (table->gnu_hash_words < 4)
+    {
+        return NULL;
+    }
+    uint32_t bucket_count = words[0];
+    uint32_t symbol_offset = words[1];
+    uint32_t bloom_size = words[2];
+    uint32_t bloom_shift = words[3];
+    size_t header_words = 4 + (size_t)bloom_size * 2;
+    if (bucket_count == 0 || bloom_size == 0 || table->gnu_hash_words < header_words + bucket_count)
+    {
+        return NULL;
+    }
+
+    uint64_t bloom_word;
+    memcpy(&bloom_word, &words[4 + (size_t)(hash / 64 % bloom_size) * 2], sizeof(bloom_word));
+    uint64_t bloom_mask = (1ull << (hash % 64)) | (1ull << ((hash >> bloom_shift) % 64));
+    if ((bloom_word & bloom_mask) != bloom_mask)
+    {
+        return NULL;
+    }
+
+    const uint32_t* buckets = words + header_words;
+    const uint32_t* chain = buckets + bucket_count;
+    size_t chain_words = table->gnu_hash_words - header_words - bucket_count;
+    for (uint32_t i = buckets[hash % bucket_count]; i >= symbol_offset && i < table->count && i - symbol_offset < chain_words; i++)
+    {
+        uint32_t chain_hash = chain[i - symbol_offset];
+        if ((chain_hash | 1) == (hash | 1) && symbol_name_equals(table, i, name, length))
+        {
+            return &table->symbols[i];
+        }
+        if (chain_hash & 1)
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static const Elf64_Sym* sysv_hash_find(const struct elf_symbol_table* table, const char* name, size_t length)
+{
+    const uint32_t* words = table->sysv_hash;
+    if (table->sysv_hash_words < 2)
+    {
+        return NULL;
+    }
+    uint32_t bucket_count = words[0];
+    uint32_t chain_count = words[1];
+    if (bucket_count == 0 || table->sysv_hash_words < 2 + (size_t)bucket_count + chain_count)
+    {
+        return NULL;
+    }
+    const uint32_t* buckets = words + 2;
+    const uint32_t* chain = buckets + bucket_count;
+    uint32_t steps = 0;
+    for (uint32_t i = buckets[elf_sysv_hash(name) % bucket_count];
+        i != STN_UNDEF && i < chain_count && i < table->count && steps < chain_count;
+        i = chain[i], steps++)
+    {
+        if (symbol_name_equals(table, i, name, length))
+        {
+            return &table->symbols[i];
+        }
+    }
+    return NULL;
+}
+
+static const Elf64_Sym* symbol_table_find(const struct elf_symbol_table* table, const char* name, uint32_t hash, size_t length)
+{
+    if (table->symbols == NULL)
+    {
+        return NULL;
+    }
+    if (table->gnu_hash)
+    {
+        return gnu_hash_find(table, name, hash, length);
+    }
+    if (table->sysv_hash)
+    {
+        return sysv_hash_find(table, name, length);
+    }
+    int i = name_index_find(&table->index, table->names, table->names_size, name, hash, length);
+    return i >= 0 ? &table->symbols[i] : NULL;
+}
+
+const Elf64_Sym* elf_reader_find_symbol(struct elf_reader* reader, const char* name)
+{
+    if (elf_reader_load_symbols(reader) != 0)
+    {
+        return NULL;
+    }
+    uint32_t hash = elf_gnu_hash(name);
+    size_t length = strlen(name) + 1;
+    const Elf64_Sym* symbol = symbol_table_find(&reader->dynamic_symbols, name, hash, length);
+    if (symbol == NULL || symbol->st_shndx == SHN_UNDEF)
+    {
+        const Elf64_Sym* static_symbol = symbol_table_find(&reader->symbols, name, hash, length);
+        if (static_symbol)
+        {
+            symbol = static_symbol;
+        }
+    }
+    return symbol;
+}
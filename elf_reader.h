@@ -0,0 +1,63 @@
+#pragma once
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* open addressing table keyed by names in a string table */
+struct elf_name_slot
+{
+    uint32_t hash;
+    uint32_t name;
+    uint32_t entry; /* entry index + 1, 0 means empty */
+};
+
+struct elf_name_index
+{
+    struct elf_name_slot* slots;
+    uint32_t mask;
+};
+
+struct elf_symbol_table
+{
+    Elf64_Sym* symbols;
+    size_t count;
+    char* names;
+    size_t names_size;
+    uint32_t* gnu_hash;
+    size_t gnu_hash_words;
+    uint32_t* sysv_hash;
+    size_t sysv_hash_words;
+    struct elf_name_index index;
+};
+
+struct elf_reader
+{
+    FILE* file;
+    Elf64_Ehdr header;
+    Elf64_Shdr* sections;
+    char* section_names;
+    size_t section_names_size;
+    struct elf_name_index section_index;
+    int symbols_loaded; /* 0 not yet, 1 loaded, -1 failed */
+    struct elf_symbol_table dynamic_symbols;
+    struct elf_symbol_table symbols;
+};
+
+uint32_t elf_gnu_hash(const char* name);
+uint32_t elf_sysv_hash(const char* name);
+
+/* loads the section headers and section names, symbol tables are loaded on first use,
+ * a failed open releases everything itself, elf_reader_close is only needed after success */
+int elf_reader_open(struct elf_reader* reader, FILE* file);
+void elf_reader_close(struct elf_reader* reader);
+
+const char* elf_reader_section_name(const struct elf_reader* reader, int section_index);
+/* returns the section index, or -1 if there is no section with that name */
+int elf_reader_find_section(const struct elf_reader* reader, const char* name);
+/* loads .dynsym, .symtab and their hash tables or indices, a failure is remembered */
+int elf_reader_load_symbols(struct elf_reader* reader);
+/* looks in .dynsym through .gnu.hash/.hash first, then in .symtab,
+ * returns NULL if the name is missing or the symbol tables could not be loaded */
+const Elf64_Sym* elf_reader_find_symbol(struct elf_reader* reader, const char* name);
@@ -2,14 +2,28 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef __x86_64__
+#include <sys/reg.h>
+#endif
+
+#include "elf_reader.h"
+#include "elf_notes.h"
 
 int is_elf64_file(FILE* file);
+void print_notes(FILE* file, const Elf64_Ehdr* header);
 
 int main(int argc, char** argv)
 {
+    int notes = argc > 1 && strcmp(argv[1], "--notes") == 0;
+    if (notes)
+    {
+        argc--;
+        argv++;
+    }
     if (argc < 2)
     {
-        fprintf(stderr, "Usage:\n\tget_elf_header elf_file\n");
+        fprintf(stderr, "Usage:\n\tget_elf_header [--notes] elf_file [name...]\n");
         exit(-1);
     }
     FILE* elf_file = fopen(argv[1], "r");
@@ -28,22 +42,19 @@ int main(int argc, char** argv)
     printf("section header number : %d\n", header.e_shnum);
     printf("name string section index : %d\n", header.e_shstrndx);
 
-    Elf64_Shdr name_string_section_header;
-    fseek(elf_file, header.e_shoff + header.e_shentsize * header.e_shstrndx, SEEK_SET);
-    fread(&name_string_section_header, header.e_shentsize, 1, elf_file);
-
-    char *name_string_table = (char*)malloc(name_string_section_header.sh_size);
-    fseek(elf_file, name_string_section_header.sh_offset, SEEK_SET);
-    fread(name_string_table, name_string_section_header.sh_size, 1, elf_file);
+    struct elf_reader reader;
+    if (elf_reader_open(&reader, elf_file) != 0)
+    {
+        fprintf(stderr, "failed to read section headers\n");
+        exit(-1);
+    }
     for (int i = 0; i < header.e_shnum; i++)
     {
-        Elf64_Shdr section_header;
-        fseek(elf_file, header.e_shoff + header.e_shentsize*i, SEEK_SET);
-        int count = fread(&section_header, header.e_shentsize, 1, elf_file);
-        assert(count == 1);
+        Elf64_Shdr section_header = reader.sections[i];
+        const char* name = elf_reader_section_name(&reader, i);
         printf("\nsection %d:\n", i);
         printf("name offset : %d\n", section_header.sh_name);
-        printf("name : %s\n", name_string_table + section_header.sh_name);
+        printf("name : %s\n", name ? name : "");
         printf("type : %d\n", section_header.sh_type);
         printf("flags : 0x%lx\n", section_header.sh_flags);
         printf("addr : 0x%lx\n", section_header.sh_addr);
@@ -71,7 +82,36 @@ int main(int argc, char** argv)
         printf("memsz : %ld\n", program_header.p_memsz);
         printf("align : %ld\n", program_header.p_align);
     }
-    free(name_string_table);
+    if (notes)
+    {
+        print_notes(elf_file, &header);
+    }
+
+    if (argc > 2 && elf_reader_load_symbols(&reader) != 0)
+    {
+        fprintf(stderr, "failed to load symbol tables, looking up sections only\n");
+    }
+    for (int i = 2; i < argc; i++)
+    {
+        printf("\nlookup %s:\n", argv[i]);
+        int section_index = elf_reader_find_section(&reader, argv[i]);
+        if (section_index >= 0)
+        {
+            printf("section : %d\n", section_index);
+        }
+        const Elf64_Sym* symbol = elf_reader_find_symbol(&reader, argv[i]);
+        if (symbol)
+        {
+            printf("symbol value : 0x%lx\n", symbol->st_value);
+            printf("symbol size : %ld\n", symbol->st_size);
+            printf("symbol section : %d\n", symbol->st_shndx);
+        }
+        if (section_index < 0 && symbol == NULL)
+        {
+            printf("not found\n");
+        }
+    }
+    elf_reader_close(&reader);
     fclose(elf_file);
     return 0;
 }
@@ -85,3 +125,61 @@ int is_elf64_file(FILE* file)
     return (header.e_ident[EI_MAG0] == 0x7f && header.e_ident[EI_MAG1] == 'E' && header.e_ident[EI_MAG2] == 'L' && header.e_ident[EI_MAG3]=='F')
         && header.e_ident[EI_CLASS] == ELFCLASS64;
 }
+
+static void print_auxv(void* context, uint64_t type, uint64_t value)
+{
+    printf("auxv %ld : 0x%lx\n", type, value);
+}
+
+static void print_file_mapping(void* context, uint64_t start, uint64_t end, uint64_t file_offset, const char* path)
+{
+    printf("file 0x%lx-0x%lx offset 0x%lx : %s\n", start, end, file_offset, path);
+}
+
+void print_notes(FILE* file, const Elf64_Ehdr* header)
+{
+    int fd = fileno(file);
+    struct elf_note_stream stream;
+    int res = elf_note_stream_open(&stream, fd, header, 1 << 20);
+    assert(res == 0);
+    struct elf_note note;
+    for (int i = 0; (res = elf_note_stream_next(&stream, &note)) == 1; i++)
+    {
+        printf("\nnote %d:\n", i);
+        printf("name : %.*s\n", (int)strnlen(note.name, note.name_size), note.name);
+        printf("type : %d\n", note.type);
+        printf("desc offset : %ld\n", note.desc_offset);
+        printf("desc size : %ld\n", note.desc_size);
+        if (note.name_size != sizeof("CORE") || memcmp(note.name, "CORE", sizeof("CORE")) != 0)
+        {
+            continue;
+        }
+        struct elf_prstatus prstatus;
+        if (note.type == NT_PRSTATUS && elf_note_prstatus(&note, &prstatus) == 0)
+        {
+            printf("pid : %d\n", prstatus.pr_pid);
+            printf("signal : %d\n", prstatus.pr_cursig);
+#ifdef __x86_64__
+            /* the register set is only laid out like the host's for a core of the same machine */
+            if (header->e_machine == EM_X86_64 && note.desc_size == sizeof(prstatus))
+            {
+                printf("rip : 0x%llx\n", prstatus.pr_reg[RIP]);
+                printf("rsp : 0x%llx\n", prstatus.pr_reg[RSP]);
+            }
+#endif
+        }
+        else if (note.type == NT_AUXV)
+        {
+            elf_note_auxv(fd, &note, print_auxv, NULL);
+        }
+        else if (note.type == NT_FILE)
+        {
+            elf_note_file_mappings(fd, &note, print_file_mapping, NULL);
+        }
+    }
+    if (res < 0)
+    {
+        fprintf(stderr, "malformed note\n");
+    }
+    elf_note_stream_close(&stream);
+}